@@ -1,6 +1,8 @@
 #pragma once
 
 #include <compare>
+#include <map>
+#include <tuple>
 
 #include "emp/io/io_utils.hpp"
 #include "emp/bits/Bits.hpp"
@@ -48,15 +50,15 @@ public:
   [[nodiscard]] int CalcScore1() const { return CountDefectDefect() + CountCoopCoop() * 3 + CountDefectCoop() * 5; }
   [[nodiscard]] int CalcScore2() const { return CountDefectDefect() + CountCoopCoop() * 3 + CountCoopDefect() * 5; }
 
-  [[nodiscard]] size_t CountRetaliation1() { return ((~player1_moves << 1) & ~player2_moves).CountOnes(); }
-  [[nodiscard]] size_t CountAggression1() { return ((~player1_moves << 1) & player2_moves).CountOnes(); }
-  [[nodiscard]] size_t CountForgiveness1() { return ((player1_moves << 1) & ~player2_moves).CountOnes(); }
-  [[nodiscard]] size_t CountReciprocity1() { return ((player1_moves << 1) & player2_moves).CountOnes(); }
+  [[nodiscard]] size_t CountRetaliation1() const { return ((~player1_moves << 1) & ~player2_moves).CountOnes(); }
+  [[nodiscard]] size_t CountAggression1() const { return ((~player1_moves << 1) & player2_moves).CountOnes(); }
+  [[nodiscard]] size_t CountForgiveness1() const { return ((player1_moves << 1) & ~player2_moves).CountOnes(); }
+  [[nodiscard]] size_t CountReciprocity1() const { return ((player1_moves << 1) & player2_moves).CountOnes(); }
 
-  [[nodiscard]] size_t CountRetaliation2() { return ((~player2_moves << 1) & ~player1_moves).CountOnes(); }
-  [[nodiscard]] size_t CountAggression2() { return ((~player2_moves << 1) & player1_moves).CountOnes(); }
-  [[nodiscard]] size_t CountForgiveness2() { return ((player2_moves << 1) & ~player1_moves).CountOnes(); }
-  [[nodiscard]] size_t CountReciprocity2() { return ((player2_moves << 1) & player1_moves).CountOnes(); }
+  [[nodiscard]] size_t CountRetaliation2() const { return ((~player2_moves << 1) & ~player1_moves).CountOnes(); }
+  [[nodiscard]] size_t CountAggression2() const { return ((~player2_moves << 1) & player1_moves).CountOnes(); }
+  [[nodiscard]] size_t CountForgiveness2() const { return ((player2_moves << 1) & ~player1_moves).CountOnes(); }
+  [[nodiscard]] size_t CountReciprocity2() const { return ((player2_moves << 1) & player1_moves).CountOnes(); }
 };
 
 class Competition {
@@ -128,19 +130,33 @@ public:
 
 class CompetitionManager {
 private:
-  mutable std::map<Competition, CompetitionResult> result_cache;
+  // Results are keyed by strategy IDs so that lookups never need to build strategy objects.
+  using key_t = std::tuple<size_t, size_t, size_t, size_t>; // id1, id2, num_rounds, hard_defect_round
+  mutable std::map<key_t, CompetitionResult> result_cache;
 
 public:
   const CompetitionResult & Compete(
-    SummaryStrategy strategy1,
-    SummaryStrategy strategy2,
+    size_t strategy1_id,
+    size_t strategy2_id,
     size_t num_rounds,
     size_t hard_defect_round) const
   {
-    Competition competition{strategy1, strategy2, num_rounds, hard_defect_round};
-    if (!result_cache.contains(competition)) {
-      result_cache[competition] = competition.Run();
+    auto [it, is_new] = result_cache.try_emplace(
+      key_t{strategy1_id, strategy2_id, num_rounds, hard_defect_round});
+    if (is_new) {
+      Competition competition{SummaryStrategy{strategy1_id}, SummaryStrategy{strategy2_id},
+                              num_rounds, hard_defect_round};
+      it->second = competition.Run();
     }
-    return result_cache[competition];
+    return it->second;
+  }
+
+  const CompetitionResult & Compete(
+    const SummaryStrategy & strategy1,
+    const SummaryStrategy & strategy2,
+    size_t num_rounds,
+    size_t hard_defect_round) const
+  {
+    return Compete(strategy1.GetID(), strategy2.GetID(), num_rounds, hard_defect_round);
   }
 };
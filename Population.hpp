@@ -1,14 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
+#include <string>
 #include <vector>
 
+#include "emp/base/notify.hpp"
 #include "emp/base/vector.hpp"
 #include "emp/config/SettingsManager.hpp"
 #include "emp/datastructs/UnorderedIndexMap.hpp"
 #include "emp/math/Random.hpp"
 
 #include "Competition.hpp"
+#include "NoisyCompetition.hpp"
 #include "Strategy.hpp"
 
 struct GenerationStats {
@@ -27,12 +32,33 @@ struct GenerationStats {
 
 };
 
+class Population;
+
+/// A statistic recorded every `interval` generations; it is only calculated when sampled.
+struct PopulationMetric {
+  std::string name;
+  size_t interval = 1;
+  std::function<double(const Population &)> calc;
+  emp::vector<std::pair<size_t, double>> samples;  // (generation, value) pairs.
+};
+
+/// Compact, immutable record of a starting population; replicates are reset from this
+/// snapshot rather than deep-copying a whole Population.
+struct PopulationSnapshot {
+  struct Entry {
+    size_t strategy_id;
+    size_t count;
+  };
+  emp::vector<Entry> entries; // Only strategies actually present in the population.
+};
+
 class Population {
 private:
   emp::vector<size_t> org_counts;                      // Map of strategy ID to num in population.
   mutable emp::vector<SummaryStrategy> strategy_info;  // Details about strategies being used.
   size_t generation = 0;
   CompetitionManager manager;
+  NoisyCompetitionManager noisy_manager;
 
   size_t max_generations = 10000;
   size_t print_step = 100;  // How many generations between printing results?
@@ -45,10 +71,24 @@ private:
   size_t hard_defect_round = emp::MAX_SIZE_T; // Hard defect will never occur
   // size_t hard_defect_round = 31; // rounds are indexed starting from 0
 
+  double noise = 0.0;         // Probability of each move being flipped (0.0 = deterministic)
+  size_t noise_samples = 1000; // Matches sampled when noisy payoffs cannot be solved exactly
+
   size_t max_replicates = 1;  // Number of runs performed in a multi-run, by default
 
   // For logging
+  size_t stats_step = 1;    // How many generations between recording GenerationStats?
   emp::vector<GenerationStats> history;
+  emp::vector<PopulationMetric> metrics;
+
+  // Fitness of each strategy under the current counts; filled in only when first needed.
+  mutable emp::vector<double> fitness_cache;
+  mutable bool fitness_cache_valid = false;
+
+  // Per-generation scratch space; kept between updates (and replicates) to avoid reallocation.
+  emp::vector<size_t> next_counts;       // Counts being built for the next generation.
+  emp::UnorderedIndexMap index_map;      // Selection weights for reproduction.
+  emp::vector<size_t> mutant_name_ids;   // Strategies that were given a name by mutation.
 
 public:
   void SetupConfig(emp::SettingsManager & settings) {
@@ -58,7 +98,10 @@ public:
     settings.AddSetting("mut_prob", mut_prob, "Probability of a single mutation", 'm');
     settings.AddSetting("memory_cost", memory_cost, "Extra cost per bit of memory", 'c');
     settings.AddSetting("hard_defect_round", hard_defect_round, "When should a defect be forced?", 'd');
+    settings.AddSetting("noise", noise, "Probability of each move being flipped", 'e');
+    settings.AddSetting("noise_samples", noise_samples, "Matches to sample for noisy payoffs with large memories", 's');
     settings.AddSetting("max_replicates", max_replicates, "How many replicates should be performed?", 'r');
+    settings.AddSetting("stats_step", stats_step, "How many generations between recording summary stats?", 't');
   }
 
   size_t GetSize() const {
@@ -118,6 +161,34 @@ public:
 
   [[nodiscard]] size_t GetGeneration() const { return generation; }
 
+  /// Record the current organism counts so that the population can be restored later.
+  [[nodiscard]] PopulationSnapshot Snapshot() const {
+    PopulationSnapshot snapshot;
+    for (size_t id = 0; id < org_counts.size(); ++id) {
+      if (org_counts[id] > 0) snapshot.entries.push_back({id, org_counts[id]});
+    }
+    return snapshot;
+  }
+
+  /// Restore the population to a previously recorded snapshot.  All buffers keep their
+  /// capacity and the competition cache is retained, since its results never change.
+  void Reset(const PopulationSnapshot & snapshot) {
+    // Shrink back to the snapshot's largest ID (entries are in ID order) so later scans
+    // don't cover mutants from earlier replicates; capacity is kept, so nothing is allocated.
+    const size_t num_ids = snapshot.entries.size() ? snapshot.entries.back().strategy_id + 1 : 0;
+    org_counts.assign(num_ids, 0);
+    for (const auto & entry : snapshot.entries) org_counts[entry.strategy_id] = entry.count;
+
+    // Names given to mutants during the previous run should not leak into the next one.
+    for (size_t id : mutant_name_ids) strategy_info[id] = SummaryStrategy{id};
+    mutant_name_ids.resize(0);
+
+    generation = 0;
+    history.resize(0);
+    for (auto & metric : metrics) metric.samples.resize(0);
+    fitness_cache_valid = false;
+  }
+
   void AddOrg(const SummaryStrategy & org, size_t count=1) {
     // emp::PrintLn("Adding org '", org.GetName(), "'.");
     size_t id = org.GetID();
@@ -127,67 +198,228 @@ public:
     // emp::PrintLn("...internal:  ", GetStrategy(id).GetName());
     if (org_counts.size() <= id) org_counts.resize(id+1);
     org_counts[id] += count;
+    fitness_cache_valid = false;
   }
 
   double CalcFitness(size_t strategy_id) const {
     double fitness = 0.0;
+    const double penalty = IDToMemoryBits(strategy_id) * memory_cost;
     for (size_t opponent_id = 0; opponent_id < org_counts.size(); ++opponent_id) {
       if (org_counts[opponent_id] == 0) continue; // Skip opponent strategies not in use.
       // Determine # of opponents; note that we should not compete with self.
       const size_t opponent_count = org_counts[opponent_id] - (strategy_id == opponent_id);
-      const double base_fitness = manager
-                                  .Compete(strategy_id, opponent_id, num_rounds, hard_defect_round)
-                                  .CalcScore1();
-      const double penalty = GetStrategy(strategy_id).GetMemorySize() * memory_cost;
+      const double base_fitness = (noise > 0.0)
+        ? noisy_manager.Compete(strategy_id, opponent_id, noise, num_rounds, hard_defect_round, noise_samples).score1
+        : manager.Compete(strategy_id, opponent_id, num_rounds, hard_defect_round).CalcScore1();
       fitness +=  (base_fitness - penalty) * opponent_count;
     }
     return fitness;
   }
 
+  /// Fitness of every strategy under the current counts (zero for strategies not in use).
+  /// Calculated at most once per generation and shared by selection and all statistics.
+  [[nodiscard]] const emp::vector<double> & GetFitnesses() const {
+    if (!fitness_cache_valid) {
+      fitness_cache.resize(org_counts.size());
+      for (size_t strategy_id = 0; strategy_id < org_counts.size(); ++strategy_id) {
+        fitness_cache[strategy_id] = org_counts[strategy_id] ? CalcFitness(strategy_id) : 0.0;
+      }
+      fitness_cache_valid = true;
+    }
+    return fitness_cache;
+  }
+
+  [[nodiscard]] double GetFitness(size_t strategy_id) const { return GetFitnesses()[strategy_id]; }
+
+  [[nodiscard]] double CalcMeanFitness() const {
+    const emp::vector<double> & fitness = GetFitnesses();
+    double total = 0.0;
+    for (size_t id = 0; id < org_counts.size(); ++id) total += fitness[id] * org_counts[id];
+    return total / GetSize();
+  }
+
+  [[nodiscard]] double CalcBestFitness() const {
+    const emp::vector<double> & fitness = GetFitnesses();
+    double best = std::numeric_limits<double>::lowest();
+    for (size_t id = 0; id < org_counts.size(); ++id) {
+      if (org_counts[id] > 0) best = std::max(best, fitness[id]);
+    }
+    return best;
+  }
+
+  [[nodiscard]] double CalcMeanMemory() const {
+    double total = 0.0;
+    for (size_t id = 0; id < org_counts.size(); ++id) total += IDToMemoryBits(id) * org_counts[id];
+    return total / GetSize();
+  }
+
+  /// Behavior of player 1 (id1) and its opponent (id2) in a single pairing, taken from the
+  /// same match cache that CalcFitness uses (expected values when noise is enabled).
+  struct PairingBehavior {
+    double cooperate = 0.0;       // Rounds in which player 1 cooperates.
+    double followups[2][2] = {};  // Rounds where player 1's previous move was [i] and the
+                                  // opponent's move is [j]; matches CompetitionResult counts.
+  };
+
+  [[nodiscard]] PairingBehavior GetPairingBehavior(size_t id1, size_t id2) const {
+    PairingBehavior behavior;
+    if (noise > 0.0) {
+      const NoisyCompetitionResult & result =
+        noisy_manager.Compete(id1, id2, noise, num_rounds, hard_defect_round, noise_samples);
+      behavior.cooperate = result.cooperate1;
+      for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 2; ++j) behavior.followups[i][j] = result.followups1[i][j];
+      }
+      return behavior;
+    }
+    const CompetitionResult & result = manager.Compete(id1, id2, num_rounds, hard_defect_round);
+    behavior.cooperate = static_cast<double>(result.GetCooperate1());
+    behavior.followups[DEFECT][DEFECT] = static_cast<double>(result.CountRetaliation1());
+    behavior.followups[DEFECT][COOPERATE] = static_cast<double>(result.CountAggression1());
+    behavior.followups[COOPERATE][DEFECT] = static_cast<double>(result.CountForgiveness1());
+    behavior.followups[COOPERATE][COOPERATE] = static_cast<double>(result.CountReciprocity1());
+    return behavior;
+  }
+
+  /// Call fun(weight, behavior) for every pairing in the population, where weight is how
+  /// often that pairing occurs (organisms never compete with themselves).
+  template <typename FUN_T>
+  void ForEachPairing(FUN_T fun) const {
+    for (size_t id1 = 0; id1 < org_counts.size(); ++id1) {
+      if (org_counts[id1] == 0) continue;
+      for (size_t id2 = 0; id2 < org_counts.size(); ++id2) {
+        if (org_counts[id2] == 0) continue;
+        const double weight = org_counts[id1] * static_cast<double>(org_counts[id2] - (id1 == id2));
+        if (weight > 0.0) fun(weight, GetPairingBehavior(id1, id2));
+      }
+    }
+  }
+
+  /// Fraction of all moves played in the population that are cooperation.
+  [[nodiscard]] double CalcCooperationRate() const {
+    double total = 0.0;
+    double total_moves = 0.0;
+    ForEachPairing([&](double weight, const PairingBehavior & behavior){
+      total += weight * behavior.cooperate;
+      total_moves += weight * num_rounds;
+    });
+    return (total_moves > 0.0) ? total / total_moves : 0.0;
+  }
+
+  /// Of all rounds following a `prev_move` (in every round but the last), the fraction in
+  /// which the opponent answered with `response`.  Population-weighted across pairings, and
+  /// zero if `prev_move` never occurs.  (DEFECT, DEFECT) is the retaliation rate,
+  /// (DEFECT, COOPERATE) aggression, (COOPERATE, DEFECT) forgiveness, and
+  /// (COOPERATE, COOPERATE) reciprocity, using the CompetitionResult definitions.
+  [[nodiscard]] double CalcResponseRate(bool prev_move, bool response) const {
+    double total = 0.0;
+    double total_opportunities = 0.0;
+    ForEachPairing([&](double weight, const PairingBehavior & behavior){
+      total += weight * behavior.followups[prev_move][response];
+      total_opportunities += weight * (behavior.followups[prev_move][DEFECT]
+                                       + behavior.followups[prev_move][COOPERATE]);
+    });
+    return (total_opportunities > 0.0) ? total / total_opportunities : 0.0;
+  }
+
+  /// Register a custom metric to be calculated every `interval` generations.
+  void AddMetric(const std::string & name, size_t interval,
+                 std::function<double(const Population &)> calc) {
+    emp_assert(interval > 0);
+    metrics.push_back(PopulationMetric{name, interval, calc, {}});
+  }
+
+  /// Register one of the built-in metrics by name; returns false if the name is unknown.
+  bool AddMetric(const std::string & name, size_t interval) {
+    std::function<double(const Population &)> calc;
+    if (name == "mean_fitness") calc = [](const Population & pop){ return pop.CalcMeanFitness(); };
+    else if (name == "best_fitness") calc = [](const Population & pop){ return pop.CalcBestFitness(); };
+    else if (name == "mean_memory") calc = [](const Population & pop){ return pop.CalcMeanMemory(); };
+    else if (name == "num_strategies") {
+      calc = [](const Population & pop){ return static_cast<double>(pop.CountStrategies()); };
+    }
+    else if (name == "cooperation") {
+      calc = [](const Population & pop){ return pop.CalcCooperationRate(); };
+    }
+    else if (name == "retaliation") {
+      calc = [](const Population & pop){ return pop.CalcResponseRate(DEFECT, DEFECT); };
+    }
+    else if (name == "aggression") {
+      calc = [](const Population & pop){ return pop.CalcResponseRate(DEFECT, COOPERATE); };
+    }
+    else if (name == "forgiveness") {
+      calc = [](const Population & pop){ return pop.CalcResponseRate(COOPERATE, DEFECT); };
+    }
+    else if (name == "reciprocity") {
+      calc = [](const Population & pop){ return pop.CalcResponseRate(COOPERATE, COOPERATE); };
+    }
+    else return false;
+    AddMetric(name, interval, calc);
+    return true;
+  }
+
   void Update(emp::Random & random) {
     ++generation;
     
     // Build an index map of weights proportional to the probability of each strategy reproducing.
-    emp::UnorderedIndexMap index_map(org_counts.size());
-    for (size_t strategy_id = 0; strategy_id < org_counts.size(); ++strategy_id) {
+    // Fitness may already be known if statistics were recorded for the previous generation.
+    const size_t num_ids = org_counts.size();
+    const emp::vector<double> & fitness = GetFitnesses();
+    index_map.ResizeClear(num_ids);
+    for (size_t strategy_id = 0; strategy_id < num_ids; ++strategy_id) {
       if (org_counts[strategy_id] == 0) continue; // Skip strategies not in use.
-      index_map[strategy_id] = org_counts[strategy_id] * CalcFitness(strategy_id);
+      index_map[strategy_id] = org_counts[strategy_id] * fitness[strategy_id];
     }
 
     // Choose who replicates and put them in a new population.
     const size_t pop_size = GetSize();
-    emp::vector<size_t> next_counts(org_counts.size());
+    next_counts.resize(num_ids);
+    std::fill(next_counts.begin(), next_counts.end(), 0);
     for (size_t i = 0; i < pop_size; ++i) {  // New pop should be same size as old pop.
       // Select
       size_t id = index_map.Index(random.GetDouble(index_map.GetWeight()));
 
       // Mutate?
       if (random.P(mut_prob)) {
-        const SummaryStrategy mut_strategy = GetStrategy(id).Mutate(random);
-        // std::cout << "Mutated Strategy: " << mut_strategy.GetStartState() << ", " << mut_strategy.GetDecisionList() << "\n";
-        id = mut_strategy.GetID();
-        // std::cout << "Mutated Strategy ID: " << id << "\n";
+        const size_t parent_id = id;
+        id = MutateStrategyID(parent_id, random);
         if (id >= next_counts.size()) {
           next_counts.resize(id+1);
         }
-        if (GetStrategy(id).GetName() == "none") GetStrategy(id) = mut_strategy;
+        if (GetStrategy(id).GetName() == "none") {
+          GetStrategy(id) = SummaryStrategy{id, emp::MakeString("mutant of ", GetStrategy(parent_id).GetName())};
+          mutant_name_ids.push_back(id);
+        }
      }
 
       ++next_counts[id];
     }
 
     std::swap(org_counts, next_counts);
+    fitness_cache_valid = false;
+  }
+
+  /// Make sure the settings are usable before starting a run; abort with an error if not.
+  void CheckConfig() const {
+    if (!(noise >= 0.0 && noise <= 1.0)) {  // Written this way so NaN is rejected too.
+      emp::notify::Error("noise (", noise, ") must be a probability between 0.0 and 1.0.");
+      abort();
+    }
+    if (noise_samples == 0) { emp::notify::Error("noise_samples must be at least 1."); abort(); }
+    if (stats_step == 0) { emp::notify::Error("stats_step must be at least 1."); abort(); }
   }
 
   void Run(emp::Random & random) {
+    CheckConfig();
     for (size_t update = 0; update <= max_generations; ++update) {
       Update(random);
-      RecordUpdate(update);
+      const bool is_done = (mut_prob == 0.0 && CountStrategies() == 1);
+      RecordUpdate(update, is_done || update == max_generations); // Always keep the final row.
       if (update % print_step == 0) {
         emp::PrintLn("Update ", update, ":");
         Print();
       }
-      if (mut_prob == 0.0 && CountStrategies() == 1) {
+      if (is_done) {
         size_t id = GetFirstStrategyID();
         emp::PrintLn("Terminated at update ", update,
           ": One strategy left (", id, ": ", strategy_info[id].GetName(), ") and no mutations.");
@@ -198,12 +430,14 @@ public:
 
   void MultiRun(size_t num_replicates = 0) {
     if (num_replicates == 0) num_replicates = max_replicates;
+    const PopulationSnapshot start_state = Snapshot();
     for (size_t replicate = 0; replicate < num_replicates; ++replicate) {
-      // random.ResetSeed(0); // Does this work?
       emp::Random random(replicate + 1);
+      Reset(start_state);
       Run(random);
       ExportHistory("history_" + std::to_string(replicate));
     }
+    Reset(start_state);
   }
 
   void Print() const {
@@ -213,7 +447,7 @@ public:
 
       std::cout << "Strategy " << strategy_id << ":"
                 << "  Count=" << org_counts[strategy_id]
-                << "  Fitness=" << CalcFitness(strategy_id)
+                << "  Fitness=" << GetFitness(strategy_id)
                 << "  StartState=" << strategy.GetStartState()
                 << "  DecisionList=" << strategy.GetDecisionList()
                 << "  Name=" << strategy.GetName()
@@ -221,7 +455,20 @@ public:
     }
   }
 
-  void RecordUpdate(int generation) {
+  /// Record any statistics or metrics that are due to be sampled at this update;
+  /// 'force' records everything (e.g., for the final update of a run).
+  void RecordUpdate(size_t update, bool force=false) {
+    if (force || update % stats_step == 0) RecordStats(update);
+    for (PopulationMetric & metric : metrics) {
+      if (!force && update % metric.interval != 0) continue;
+      if (metric.samples.size() && metric.samples.back().first == update) continue;
+      metric.samples.emplace_back(update, metric.calc(*this));
+    }
+  }
+
+  void RecordStats(size_t generation) {
+    if (history.size() && history.back().generation == static_cast<int>(generation)) return;
+
     double best_f = std::numeric_limits<double>::lowest();
     double sum_f = 0.0;
     size_t fittest_id = 0;
@@ -236,7 +483,7 @@ public:
     for (size_t strategy_id = 0; strategy_id < org_counts.size(); ++strategy_id) {
       if (org_counts[strategy_id] == 0) continue; // Skip strategies not in use
 
-      double strategy_fitness = CalcFitness(strategy_id);
+      double strategy_fitness = GetFitness(strategy_id);
       if (strategy_fitness > best_f) {
         best_f = strategy_fitness;
         fittest_id = strategy_id;
@@ -248,7 +495,7 @@ public:
         most_common_id = strategy_id;
       }
 
-      size_t memory_size = GetStrategy(strategy_id).GetMemorySize();
+      size_t memory_size = IDToMemoryBits(strategy_id);
       if (memory_size > highest_memory) {
         highest_memory = memory_size;
         most_memory_id = strategy_id;
@@ -260,7 +507,7 @@ public:
     double mean_f = sum_f / GetSize();
     double mean_memory = sum_memory / GetSize();
 
-    history.emplace_back(generation, best_f, mean_f, fittest_id, 
+    history.emplace_back(static_cast<int>(generation), best_f, mean_f, fittest_id, 
       highest_count, most_common_id,
       highest_memory, mean_memory, most_memory_id);
   }
@@ -276,13 +523,13 @@ public:
       fitness_file << std::fixed << std::setprecision(3);
 
       for (size_t update = 0; update < history.size(); ++update) {
-        fitness_file << update << ","
+        fitness_file << history[update].generation << ","
           << history[update].best_fitness << ","
           << history[update].mean_fitness << ","
           << history[update].fittest_id << ",";
-        SummaryStrategy fittest(history[update].fittest_id);
-        emp::BitVector fittest_start_state = fittest.GetStartState();
-        emp::BitVector fittest_decision_list = fittest.GetDecisionList();
+        const SummaryStrategy & fittest = GetStrategy(history[update].fittest_id);
+        const emp::BitVector & fittest_start_state = fittest.GetStartState();
+        const emp::BitVector & fittest_decision_list = fittest.GetDecisionList();
         fitness_file << fittest_start_state << "," << fittest_decision_list << "\n";
       }
     }
@@ -291,13 +538,13 @@ public:
       count_file << std::fixed << std::setprecision(3);
 
       for (size_t update = 0; update < history.size(); ++update) {
-        count_file << update << ","
+        count_file << history[update].generation << ","
           << history[update].highest_count << ","
           << history[update].most_common_id << ",";
         
-        SummaryStrategy most_common(history[update].most_common_id);
-        emp::BitVector most_common_start_state = most_common.GetStartState();
-        emp::BitVector most_common_decision_list = most_common.GetDecisionList();
+        const SummaryStrategy & most_common = GetStrategy(history[update].most_common_id);
+        const emp::BitVector & most_common_start_state = most_common.GetStartState();
+        const emp::BitVector & most_common_decision_list = most_common.GetDecisionList();
         count_file << most_common_start_state << "," << most_common_decision_list << "\n";
       }
     }
@@ -305,16 +552,28 @@ public:
       memory_file << "Generation,Highest_Mem,Mean_Mem,Most_Mem_ID,Most_Mem_StartState,Most_Mem_DecisionList\n";
       memory_file << std::fixed << std::setprecision(3);
       for (size_t update = 0; update < history.size(); ++update) {
-        memory_file << update << ","
+        memory_file << history[update].generation << ","
           << history[update].highest_memory << ","
           << history[update].mean_memory << ","
           << history[update].most_memory_id << ",";
         
-        SummaryStrategy most_memory(history[update].most_memory_id);
-        emp::BitVector most_memory_start_state = most_memory.GetStartState();
-        emp::BitVector most_memory_decision_list = most_memory.GetDecisionList();
+        const SummaryStrategy & most_memory = GetStrategy(history[update].most_memory_id);
+        const emp::BitVector & most_memory_start_state = most_memory.GetStartState();
+        const emp::BitVector & most_memory_decision_list = most_memory.GetDecisionList();
         memory_file << most_memory_start_state << "," << most_memory_decision_list << "\n";
       }
     }
+
+    if (metrics.size() == 0) return;
+    std::ofstream metric_file(filename + "_metrics.csv");
+    if (metric_file.is_open()) {
+      metric_file << "Generation,Metric,Value\n";
+      metric_file << std::fixed << std::setprecision(3);
+      for (const PopulationMetric & metric : metrics) {
+        for (const auto & [sample_gen, value] : metric.samples) {
+          metric_file << sample_gen << "," << metric.name << "," << value << "\n";
+        }
+      }
+    }
   }
 };
@@ -11,10 +11,13 @@
 
 #pragma once
 
+#include <array>
+#include <bit>
 #include <string>
 
 #include "emp/bits/Bits.hpp"
 #include "emp/math/math.hpp"
+#include "emp/math/Random.hpp"
 
 static constexpr bool COOPERATE = true;
 static constexpr bool DEFECT = false;
@@ -40,26 +43,103 @@ constexpr size_t CalcFirstStrategyID(size_t mem_bits) {
   return total;
 }
 
-// Finds the actual memory size for a strategy
-constexpr size_t IDToMemoryBits(size_t strategy_id) {
-  size_t mem_bits = 0;
-  size_t num_strats = CountStrategies(0);
-  while (strategy_id >= num_strats) {
-    strategy_id -= num_strats;
-    num_strats = CountStrategies(++mem_bits);
+// Table of the first strategy ID in each memory-size group; the final entry is one past
+// the last valid ID.  STRATEGY_GROUP_OFFSETS[m] == 2*(4^m - 1)/3.
+static constexpr auto STRATEGY_GROUP_OFFSETS = [](){
+  std::array<size_t, MAX_MEM_SIZE+2> offsets{};
+  for (size_t mem_bits = 1; mem_bits < offsets.size(); ++mem_bits) {
+    offsets[mem_bits] = offsets[mem_bits-1] + (size_t{2} << (2 * (mem_bits-1)));
   }
+  return offsets;
+}();
+
+// Packed form of a strategy: bit i of each field matches bit i of the associated BitVector.
+struct StrategyCode {
+  size_t mem_bits = 0;       // Memory size of the strategy.
+  size_t start_state = 0;    // mem_bits bits of initial memory.
+  size_t decision_list = 0;  // mem_bits+1 bits of decisions, indexed by opponent defects.
+};
+
+// Finds the actual memory size for a strategy.
+// Since the group offsets are 2*(4^m - 1)/3, ID >= offset(m) exactly when
+// (3*ID + 2)/2 >= 4^m, so the group is half of the highest set bit of that value.
+constexpr size_t IDToMemoryBits(size_t strategy_id) {
+  const size_t mem_bits = static_cast<size_t>(std::bit_width((3 * strategy_id + 2) / 2) - 1) / 2;
+  emp_assert(mem_bits <= MAX_MEM_SIZE, strategy_id);
   return mem_bits;
 }
 
 // Finds the offset of a strategy within its memory size "group", or local ID
 constexpr size_t IDToMemoryDecisionList(size_t strategy_id) {
-  size_t mem_bits = 0;
-  size_t num_strats = CountStrategies(0);
-  while (strategy_id >= num_strats) {
-    strategy_id -= num_strats;
-    num_strats = CountStrategies(++mem_bits);
+  return strategy_id - STRATEGY_GROUP_OFFSETS[IDToMemoryBits(strategy_id)];
+}
+
+// Convert a strategy ID to its packed memory size, starting memory, and decision list.
+constexpr StrategyCode DecodeStrategyID(size_t strategy_id) {
+  const size_t mem_bits = IDToMemoryBits(strategy_id);
+  const size_t local_id = strategy_id - STRATEGY_GROUP_OFFSETS[mem_bits];
+  // First mem_bits are starting memory; next mem_bits+1 are the decision list.
+  return StrategyCode{ mem_bits,
+                       local_id & ((size_t{1} << mem_bits) - 1),
+                       local_id >> mem_bits };
+}
+
+// Convert a packed strategy back to its ID.
+constexpr size_t EncodeStrategyID(const StrategyCode & code) {
+  emp_assert(code.mem_bits <= MAX_MEM_SIZE, code.mem_bits);
+  return STRATEGY_GROUP_OFFSETS[code.mem_bits]
+         + code.start_state
+         + (code.decision_list << code.mem_bits);
+}
+
+static_assert(IDToMemoryBits(0) == 0 && IDToMemoryBits(1) == 0);
+static_assert(IDToMemoryBits(2) == 1 && IDToMemoryBits(9) == 1);
+static_assert(IDToMemoryBits(10) == 2 && IDToMemoryBits(41) == 2 && IDToMemoryBits(42) == 3);
+static_assert(IDToMemoryBits(STRATEGY_GROUP_OFFSETS[MAX_MEM_SIZE+1] - 1) == MAX_MEM_SIZE);
+static_assert(EncodeStrategyID(DecodeStrategyID(2709)) == 2709);
+
+// Mutate a strategy directly by ID, without building a SummaryStrategy.
+inline size_t MutateStrategyID(size_t strategy_id, emp::Random & random) {
+  StrategyCode code = DecodeStrategyID(strategy_id);
+
+  constexpr double mem_size_prob = 0.01;
+  constexpr double bit_flip_prob = 1.0 - mem_size_prob;
+
+  double mut_type_p = random.GetDouble();
+  // Check if we are changing memory size!
+  if (mut_type_p < mem_size_prob) {
+    if (mut_type_p < mem_size_prob / 2.0) { // Shrink!
+      if (code.mem_bits > 0) {
+        --code.mem_bits;
+        code.start_state &= (size_t{1} << code.mem_bits) - 1;
+        code.decision_list &= (size_t{1} << (code.mem_bits+1)) - 1;
+      }
+    } else { // Grow!
+      if (code.mem_bits < MAX_MEM_SIZE) {
+        code.start_state |= size_t{random.P(0.5)} << code.mem_bits;
+        code.decision_list |= size_t{random.P(0.5)} << (code.mem_bits+1);
+        ++code.mem_bits;
+      }
+    }
   }
-  return strategy_id;
+
+  // Otherwise, flip a bit!
+  else {
+    mut_type_p = (mut_type_p - mem_size_prob) / bit_flip_prob; // Renormalize
+    if (mut_type_p < 0.5) {  // Mutate start state.
+      const size_t num_bits = code.mem_bits;
+      size_t bit_id = num_bits * mut_type_p / 0.5;
+      if (bit_id < num_bits) { code.start_state ^= size_t{1} << bit_id; }
+    }
+    else {  // Mutate decision list.
+      const size_t num_bits = code.mem_bits + 1;
+      mut_type_p -= 0.5;
+      size_t bit_id = num_bits * mut_type_p / 0.5;
+      code.decision_list ^= size_t{1} << bit_id;
+    }
+  }
+
+  return EncodeStrategyID(code);
 }
 
 class SummaryStrategy {
@@ -67,27 +147,25 @@ private:
   emp::BitVector start_state{};   // Initial memory
   emp::BitVector decision_list{}; // Choices based on num defects by opponent.
   std::string name;
+  size_t id = 0;                  // Cached strategy ID; fixed once constructed.
+
+  [[nodiscard]] size_t CalcID() const {
+    // In case start state is empty
+    size_t start_state_id = (start_state.size() > 0) ? start_state.GetUInt32(0) : 0;
+    size_t decision_id = decision_list.GetUInt32(0);
+    return EncodeStrategyID({start_state.size(), start_state_id, decision_id});
+  }
 
 public:
   SummaryStrategy(emp::BitVector start_state,
                   emp::BitVector decision_list,
                   std::string name="none")
-    : start_state(start_state), decision_list(decision_list), name(name) {}
-
-  SummaryStrategy(size_t strategy_id=0, std::string name="none") : name(name) {
-    size_t mem_bits = 0;
-    size_t num_strats = CountStrategies(0);
-    while (strategy_id >= num_strats) {
-      strategy_id -= num_strats;
-      num_strats = CountStrategies(++mem_bits);
-    }
-    // strategy_id now contains the local ID
-    emp_assert(strategy_id < CountStrategies(mem_bits));
-    // first mem_bits is starting memory
-    if (mem_bits > 0) start_state.Import(strategy_id & emp::MaskLow(mem_bits), mem_bits);
+    : start_state(start_state), decision_list(decision_list), name(name), id(CalcID()) {}
 
-    // next mem_bits+1 is decision_list
-    decision_list.Import((strategy_id >> mem_bits) & emp::MaskLow(mem_bits+1), mem_bits+1);
+  SummaryStrategy(size_t strategy_id=0, std::string name="none") : name(name), id(strategy_id) {
+    const StrategyCode code = DecodeStrategyID(strategy_id);
+    if (code.mem_bits > 0) start_state.Import(code.start_state, code.mem_bits);
+    decision_list.Import(code.decision_list, code.mem_bits+1);
   }
   SummaryStrategy(const SummaryStrategy &) = default;
   SummaryStrategy(SummaryStrategy &&) = default;
@@ -114,13 +192,7 @@ public:
   [[nodiscard]] const emp::BitVector & GetDecisionList() const { return decision_list; }
 
   [[nodiscard]] size_t GetMemorySize() const { return start_state.size(); }
-  [[nodiscard]] size_t GetID() const {
-    size_t offset = CalcFirstStrategyID(GetMemorySize());
-    // In case start state is empty
-    size_t start_state_id = (start_state.size() > 0) ? start_state.GetUInt32(0) : 0;
-    size_t decision_id = decision_list.GetUInt32(0);
-    return offset + start_state_id + (decision_id << start_state.size());
-  }
+  [[nodiscard]] size_t GetID() const { return id; }
 
   // TODO: Bug when memory is empty
   [[nodiscard]] bool GetAction(const emp::BitVector & mem) const {
@@ -132,47 +204,7 @@ public:
     return decision_list[num_opponent_defects];
   }
 
-  SummaryStrategy Mutate(emp::Random & random) {
-    emp::BitVector new_start_state = start_state;
-    emp::BitVector new_decision_list = decision_list;
-
-    constexpr double mem_size_prob = 0.01;
-    constexpr double bit_flip_prob = 1.0 - mem_size_prob;
-
-    double mut_type_p = random.GetDouble();
-    // Check if we are changing memory size!
-    if (mut_type_p < mem_size_prob) {
-      if (mut_type_p < mem_size_prob / 2.0) { // Shrink!
-        if (new_start_state.size() > 0) {
-          new_start_state.PopBack();
-          new_decision_list.PopBack();
-        }
-      } else { // Grow!          
-        if (new_start_state.size() < MAX_MEM_SIZE) {
-          new_start_state.PushBack(random.P(0.5));
-          new_decision_list.PushBack(random.P(0.5));
-        }
-      }
-    }
-
-    // Otherwise, flip a bit!
-    else {
-      mut_type_p = (mut_type_p - mem_size_prob) / bit_flip_prob; // Renormalize
-      if (mut_type_p < 0.5) {  // Mutate start state.
-        const size_t num_bits = new_start_state.size();
-        size_t bit_id = num_bits * mut_type_p / 0.5;
-        if (bit_id < num_bits) { new_start_state.Toggle(bit_id); }
-      }
-      else {  // Mutate decision list.
-        const size_t num_bits = new_decision_list.size();
-        emp_assert(num_bits > 0);
-        mut_type_p -= 0.5;
-        size_t bit_id = num_bits * mut_type_p / 0.5;
-        new_decision_list.Toggle(bit_id);
-      }
-    }
-
-    emp::String new_name = emp::MakeString("mutant of ", GetName());
-    return SummaryStrategy{new_start_state, new_decision_list, new_name};
+  SummaryStrategy Mutate(emp::Random & random) const {
+    return SummaryStrategy{MutateStrategyID(id, random), emp::MakeString("mutant of ", name)};
   }
 };
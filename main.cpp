@@ -60,6 +60,22 @@ int main(int argc, char * argv[])
     },
     "Add strategy with NAME DECISION_LIST STARTING_MEMORY\nSkip STARTING_MEMORY if empty.");
 
+  // Add a "Metric" keyword to record extra statistics during each run.
+  settings.AddKeyword("Metric",
+    [&pop](emp::vector<emp::String> args){
+      if (args.size() < 1) { emp::notify::Error("Must specify NAME of metric to record."); abort(); }
+      emp::String name = args[0];
+      size_t interval = 1;
+      if (args.size() > 1) {
+        if (!args[1].OnlyDigits()) { emp::notify::Error("INTERVAL for metric '", name, "' must be a whole number."); abort(); }
+        interval = args[1].AsULL();
+        if (interval == 0) { emp::notify::Error("INTERVAL for metric '", name, "' must be positive."); abort(); }
+      }
+      if (!pop.AddMetric(name, interval)) { emp::notify::Error("Metric '", name, "' Unknown!  Cannot record."); abort(); }
+      emp::PrintLn("Recording metric '", name, "' every ", interval, " generations.");
+    },
+    "Record metric NAME every INTERVAL generations (default 1).\nOptions: mean_fitness, best_fitness, mean_memory, num_strategies,\ncooperation, retaliation, aggression, forgiveness, reciprocity");
+
   settings.AddKeyword("Run",
     [&pop](emp::vector<emp::String> args){
       // Determine which random seeds to use.
@@ -76,14 +92,16 @@ int main(int argc, char * argv[])
         }
       }
 
-      // Do a separate run for each seed.
+      // Do a separate run for each seed, resetting to the original population each time.
+      const PopulationSnapshot start_state = pop.Snapshot();
       for (size_t cur_seed = start_seed; cur_seed < end_seed; ++cur_seed) {
         emp::PrintLn("=== Starting Run with seed ", cur_seed, " ===");
         emp::Random random(cur_seed);
-        Population test_pop = pop; // Keep the original population with base stats.
-        test_pop.Run(random);
-        test_pop.ExportHistory("history" + std::to_string(cur_seed));
+        pop.Reset(start_state);
+        pop.Run(random);
+        pop.ExportHistory("history" + std::to_string(cur_seed));
       }
+      pop.Reset(start_state); // Leave the base population in place for later keywords.
     },
     "Add strategy with NAME DECISION_LIST STARTING_MEMORY\nSkip STARTING_MEMORY if empty.");
 